@@ -0,0 +1,92 @@
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <ios>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "twsfw/game.hpp"
+
+namespace
+{
+std::basic_string<uint8_t> read_wasm(const char *path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+
+    const std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    std::basic_string data(static_cast<size_t>(size), uint8_t{});
+    file.read(std::bit_cast<char *>(data.data()), size);
+    return data;
+}
+
+constexpr size_t n_teams = 8;
+constexpr size_t multiplicity = 4;
+constexpr size_t ticks_per_second = 60;
+constexpr auto t = 1.F / static_cast<float>(ticks_per_second);
+constexpr int32_t n_steps = 10;
+
+twsfw::Game make_game(const std::basic_string<uint8_t> &wasm_agent)
+{
+    return twsfw::Game{std::vector(n_teams, wasm_agent),
+                       multiplicity,
+                       {.agent_radius = .1F,
+                        .agent_healing_rate = 6.F,
+                        .agent_cooldown = 2.F,
+                        .agent_max_velocity = 1.F,
+                        .agent_max_rotation_speed = 2.F,
+                        .restitution = .5F,
+                        .missile_max_velocity = 2.F},
+                       ticks_per_second};
+}
+
+double us_per_tick(const std::chrono::steady_clock::duration elapsed,
+                   const size_t n_ticks)
+{
+    return std::chrono::duration<double, std::micro>(elapsed).count()
+        / static_cast<double>(n_ticks);
+}
+}  // namespace
+
+// Usage: benchmark <agent.wasm>...
+// Lets every given agent play against itself and reports the time per tick,
+// once with Game::advance and once with Game::tick in a loop, which also
+// exports the state on every tick.
+// To see what SIMD buys, compare scalar_agent.wasm with simd_agent.wasm: both
+// are simd_agent.c, built without and with -msimd128.
+int main(int argc, char *argv[])
+{
+    assert(argc >= 2);
+
+    constexpr size_t n_ticks = 1'000;
+
+    for (int i = 1; i < argc; i++) {
+        const auto *path = argv[i];  // NOLINT
+        const auto wasm_agent = read_wasm(path);
+
+        auto game = make_game(wasm_agent);
+        auto start = std::chrono::steady_clock::now();
+        const auto summary = game.advance(n_ticks, t, n_steps);
+        const auto advance_time = std::chrono::steady_clock::now() - start;
+
+        game = make_game(wasm_agent);
+        start = std::chrono::steady_clock::now();
+        for (auto tick = 0U; tick < n_ticks; tick++) {
+            const auto state = game.tick(t, n_steps);
+            assert(state.agents.size() == n_teams * multiplicity);
+        }
+        const auto tick_time = std::chrono::steady_clock::now() - start;
+
+        std::cout << path << ": advance "
+                  << us_per_tick(advance_time, summary.ticks)
+                  << " us/tick, tick " << us_per_tick(tick_time, n_ticks)
+                  << " us/tick, " << summary.teams_alive << " teams alive\n";
+    }
+
+    return 0;
+}
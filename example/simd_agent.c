@@ -0,0 +1,82 @@
+#include "twsfw_agent.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <emscripten.h>
+
+#include "twsfw_sdk.h"
+
+static float *scratch = NULL;
+static int32_t scratch_size = 0;
+
+static float *get_scratch(int32_t size)
+{
+    if (size > scratch_size) {
+        scratch = realloc(scratch, (size_t)size * sizeof(float));
+        scratch_size = size;
+    }
+    return scratch;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void *twsfw_agent_alloc(int32_t n_bytes)
+{
+    static void *input = NULL;
+    free(input);
+    input = malloc((size_t)n_bytes);
+    return input;
+}
+
+EMSCRIPTEN_KEEPALIVE
+float twsfw_agent_act(const struct twsfw_agent *agents,
+                      int32_t n_agents,
+                      const struct twsfw_missile *missiles,
+                      int32_t n_missiles,
+                      int32_t missile_cooldown,
+                      const struct twsfw_world *world,
+                      int32_t id,
+                      int32_t *action)
+{
+    const struct twsfw_agent *self = &agents[id];
+    const int32_t n = n_agents > n_missiles ? n_agents : n_missiles;
+    float *buffer = get_scratch(n);
+
+    twsfw_sdk_threat_scores(
+        missiles, n_missiles, self->r, id, world->agent_radius, buffer);
+    float threat = 0.F;
+    for (int32_t i = 0; i < n_missiles; i++) {
+        threat = fmaxf(threat, buffer[i]);
+    }
+    if (threat > 0.F) {
+        *action = ACCELERATE;
+        return 1.F;
+    }
+
+    /* Aim at the living enemy that takes the smallest turn. */
+    twsfw_sdk_angles_to(self, agents, n_agents, buffer);
+    int32_t target = -1;
+    for (int32_t i = 0; i < n_agents; i++) {
+        const int enemy = agents[i].team != self->team;
+        const int alive = agents[i].hp > 0;
+        if (enemy && alive
+            && (target < 0 || fabsf(buffer[i]) < fabsf(buffer[target])))
+        {
+            target = i;
+        }
+    }
+    if (target < 0) {
+        *action = ACCELERATE;
+        return 0.F;
+    }
+
+    const float angle = buffer[target];
+    if (fabsf(angle) > world->agent_radius) {
+        *action = ROTATE;
+        return angle;
+    }
+
+    *action = missile_cooldown <= 0 ? FIRE : ACCELERATE;
+    return 0.F;
+}
@@ -5,7 +5,7 @@
 #include <emscripten.h>
 
 EMSCRIPTEN_KEEPALIVE
-float twsfw_agent_act(struct twsfw_agent *agents,
+float twsfw_agent_act(const struct twsfw_agent *agents,
                       int32_t n_agents,
                       const struct twsfw_missile *missiles,
                       int32_t n_missiles,
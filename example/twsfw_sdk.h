@@ -0,0 +1,264 @@
+#pragma once
+
+/* Header-only helpers for agents. With -msimd128 the batch routines process
+ * four entities per instruction, otherwise they fall back to scalar loops.
+ *
+ * Agents live on the unit sphere: positions r are unit vectors, and an agent
+ * or missile travels along the great circle with normal u, i.e. towards
+ * u x r. */
+
+#include <math.h>
+#include <stdint.h>
+
+#include "twsfw_agent.h"
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+static inline float twsfw_sdk_dot(struct twsfw_vec a, struct twsfw_vec b)
+{
+    return (a.x * b.x) + (a.y * b.y) + (a.z * b.z);
+}
+
+static inline struct twsfw_vec twsfw_sdk_cross(struct twsfw_vec a,
+                                               struct twsfw_vec b)
+{
+    struct twsfw_vec c = {(a.y * b.z) - (a.z * b.y),
+                          (a.z * b.x) - (a.x * b.z),
+                          (a.x * b.y) - (a.y * b.x)};
+    return c;
+}
+
+#ifdef __wasm_simd128__
+/* dot(p, v[i]) for the four vectors v0..v3. Each vector is loaded with one
+ * 16 byte load, so it must be followed by at least one more float of the
+ * same struct (true for r and u of agents and missiles), and the four loads
+ * are transposed into x, y and z lanes with shuffles. */
+static inline v128_t twsfw_sdk_dot4_(struct twsfw_vec p,
+                                     const struct twsfw_vec *v0,
+                                     const struct twsfw_vec *v1,
+                                     const struct twsfw_vec *v2,
+                                     const struct twsfw_vec *v3)
+{
+    const v128_t a0 = wasm_v128_load(v0);
+    const v128_t a1 = wasm_v128_load(v1);
+    const v128_t a2 = wasm_v128_load(v2);
+    const v128_t a3 = wasm_v128_load(v3);
+
+    const v128_t xy01 = wasm_i32x4_shuffle(a0, a1, 0, 4, 1, 5);
+    const v128_t xy23 = wasm_i32x4_shuffle(a2, a3, 0, 4, 1, 5);
+    const v128_t zw01 = wasm_i32x4_shuffle(a0, a1, 2, 6, 3, 7);
+    const v128_t zw23 = wasm_i32x4_shuffle(a2, a3, 2, 6, 3, 7);
+
+    const v128_t x = wasm_i32x4_shuffle(xy01, xy23, 0, 1, 4, 5);
+    const v128_t y = wasm_i32x4_shuffle(xy01, xy23, 2, 3, 6, 7);
+    const v128_t z = wasm_i32x4_shuffle(zw01, zw23, 0, 1, 4, 5);
+
+    v128_t d = wasm_f32x4_mul(wasm_f32x4_splat(p.x), x);
+    d = wasm_f32x4_add(d, wasm_f32x4_mul(wasm_f32x4_splat(p.y), y));
+    return wasm_f32x4_add(d, wasm_f32x4_mul(wasm_f32x4_splat(p.z), z));
+}
+#endif
+
+/* out[i] = dot(p, agents[i].r), the cosine of the angular distance between p
+ * and each agent. Larger means closer. */
+static inline void twsfw_sdk_proximity(const struct twsfw_agent *agents,
+                                       int32_t n_agents,
+                                       struct twsfw_vec p,
+                                       float *out)
+{
+    int32_t i = 0;
+#ifdef __wasm_simd128__
+    for (; i + 4 <= n_agents; i += 4) {
+        wasm_v128_store(out + i,
+                        twsfw_sdk_dot4_(p,
+                                        &agents[i].r,
+                                        &agents[i + 1].r,
+                                        &agents[i + 2].r,
+                                        &agents[i + 3].r));
+    }
+#endif
+    for (; i < n_agents; i++) {
+        out[i] = twsfw_sdk_dot(p, agents[i].r);
+    }
+}
+
+/* out[i] = dot(u, agents[i].r), the distance of each agent from the great
+ * circle with normal u. A missile fired by an agent with heading normal u
+ * passes agent i if fabsf(out[i]) < world->agent_radius. */
+static inline void twsfw_sdk_plane_offsets(const struct twsfw_agent *agents,
+                                           int32_t n_agents,
+                                           struct twsfw_vec u,
+                                           float *out)
+{
+    twsfw_sdk_proximity(agents, n_agents, u, out);
+}
+
+/* atan2f(y, x) to within 1e-5 rad. Both builds use this approximation, so
+ * that scalar and SIMD agents aim alike. */
+static inline float twsfw_sdk_atan2_(float y, float x)
+{
+    const float ax = fabsf(x);
+    const float ay = fabsf(y);
+    const float a = fminf(ax, ay) / fmaxf(fmaxf(ax, ay), 1e-30F);
+    const float s = a * a;
+
+    float p = -0.0117191309F;
+    p = (p * s) + 0.0526473373F;
+    p = (p * s) - 0.116426468F;
+    p = (p * s) + 0.193540365F;
+    p = (p * s) - 0.332622826F;
+    p = (p * s) + 0.999977231F;
+    float r = p * a;
+    if (ay > ax) {
+        r = 1.57079637F - r;
+    }
+    if (x < 0.F) {
+        r = 3.14159274F - r;
+    }
+    return copysignf(r, y);
+}
+
+#ifdef __wasm_simd128__
+static inline v128_t twsfw_sdk_atan2x4_(v128_t y, v128_t x)
+{
+    const v128_t ax = wasm_f32x4_abs(x);
+    const v128_t ay = wasm_f32x4_abs(y);
+    const v128_t a = wasm_f32x4_div(
+        wasm_f32x4_min(ax, ay),
+        wasm_f32x4_max(wasm_f32x4_max(ax, ay), wasm_f32x4_splat(1e-30F)));
+    const v128_t s = wasm_f32x4_mul(a, a);
+
+    v128_t p = wasm_f32x4_splat(-0.0117191309F);
+    p = wasm_f32x4_add(wasm_f32x4_mul(p, s), wasm_f32x4_splat(0.0526473373F));
+    p = wasm_f32x4_sub(wasm_f32x4_mul(p, s), wasm_f32x4_splat(0.116426468F));
+    p = wasm_f32x4_add(wasm_f32x4_mul(p, s), wasm_f32x4_splat(0.193540365F));
+    p = wasm_f32x4_sub(wasm_f32x4_mul(p, s), wasm_f32x4_splat(0.332622826F));
+    p = wasm_f32x4_add(wasm_f32x4_mul(p, s), wasm_f32x4_splat(0.999977231F));
+    v128_t r = wasm_f32x4_mul(p, a);
+    r = wasm_v128_bitselect(wasm_f32x4_sub(wasm_f32x4_splat(1.57079637F), r),
+                            r,
+                            wasm_f32x4_gt(ay, ax));
+    r = wasm_v128_bitselect(wasm_f32x4_sub(wasm_f32x4_splat(3.14159274F), r),
+                            r,
+                            wasm_f32x4_lt(x, wasm_f32x4_splat(0.F)));
+    return wasm_v128_or(r, wasm_v128_and(y, wasm_f32x4_splat(-0.F)));
+}
+#endif
+
+/* Index of the closest living agent of another team, or -1. `scratch` must
+ * hold n_agents floats. */
+static inline int32_t twsfw_sdk_nearest_enemy(const struct twsfw_agent *agents,
+                                              int32_t n_agents,
+                                              int32_t id,
+                                              float *scratch)
+{
+    twsfw_sdk_proximity(agents, n_agents, agents[id].r, scratch);
+
+    int32_t nearest = -1;
+    float best = -2.F;
+    for (int32_t i = 0; i < n_agents; i++) {
+        const int enemy = agents[i].team != agents[id].team;
+        const int alive = agents[i].hp > 0;
+        if (enemy && alive && scratch[i] > best) {
+            best = scratch[i];
+            nearest = i;
+        }
+    }
+
+    return nearest;
+}
+
+/* Angle by which `self` has to rotate its heading normal u around r so that
+ * its great circle passes through `target`. */
+static inline float twsfw_sdk_angle_to(const struct twsfw_agent *self,
+                                       struct twsfw_vec target)
+{
+    const struct twsfw_vec n = twsfw_sdk_cross(self->r, target);
+    return atan2f(twsfw_sdk_dot(self->r, twsfw_sdk_cross(self->u, n)),
+                  twsfw_sdk_dot(self->u, n));
+}
+
+/* out[i] = twsfw_sdk_angle_to(self, agents[i].r) for all agents at once, to
+ * within 1e-4 rad. */
+static inline void twsfw_sdk_angles_to(const struct twsfw_agent *self,
+                                       const struct twsfw_agent *agents,
+                                       int32_t n_agents,
+                                       float *out)
+{
+    /* With r and u orthonormal and h = u x r the heading, the angle to a
+     * target t is atan2(dot(t, u), dot(t, h)). */
+    const struct twsfw_vec h = twsfw_sdk_cross(self->u, self->r);
+
+    int32_t i = 0;
+#ifdef __wasm_simd128__
+    for (; i + 4 <= n_agents; i += 4) {
+        const struct twsfw_agent *a = agents + i;
+        const v128_t across =
+            twsfw_sdk_dot4_(self->u, &a[0].r, &a[1].r, &a[2].r, &a[3].r);
+        const v128_t along =
+            twsfw_sdk_dot4_(h, &a[0].r, &a[1].r, &a[2].r, &a[3].r);
+        wasm_v128_store(out + i, twsfw_sdk_atan2x4_(across, along));
+    }
+#endif
+    for (; i < n_agents; i++) {
+        out[i] = twsfw_sdk_atan2_(twsfw_sdk_dot(agents[i].r, self->u),
+                                  twsfw_sdk_dot(agents[i].r, h));
+    }
+}
+
+/* out[i] scores how dangerous missile i is to an agent at r: zero for
+ * missiles of `id` and for those off course by more than `radius`, growing
+ * with alignment, proximity and speed otherwise. */
+static inline void twsfw_sdk_threat_scores(const struct twsfw_missile *missiles,
+                                           int32_t n_missiles,
+                                           struct twsfw_vec r,
+                                           int32_t id,
+                                           float radius,
+                                           float *out)
+{
+    int32_t i = 0;
+#ifdef __wasm_simd128__
+    const v128_t zero = wasm_f32x4_splat(0.F);
+    const v128_t one = wasm_f32x4_splat(1.F);
+    const v128_t inv_radius = wasm_f32x4_splat(1.F / radius);
+    const v128_t own_id = wasm_i32x4_splat(id);
+
+    for (; i + 4 <= n_missiles; i += 4) {
+        const struct twsfw_missile *m = missiles + i;
+
+        const v128_t offset = wasm_f32x4_abs(
+            twsfw_sdk_dot4_(r, &m[0].u, &m[1].u, &m[2].u, &m[3].u));
+        const v128_t course = wasm_f32x4_max(
+            zero, wasm_f32x4_sub(one, wasm_f32x4_mul(offset, inv_radius)));
+        const v128_t closeness = wasm_f32x4_add(
+            one, twsfw_sdk_dot4_(r, &m[0].r, &m[1].r, &m[2].r, &m[3].r));
+        const v128_t v = wasm_f32x4_make(m[0].v, m[1].v, m[2].v, m[3].v);
+
+        const v128_t score =
+            wasm_f32x4_mul(wasm_f32x4_mul(course, closeness), v);
+        const v128_t own = wasm_i32x4_eq(
+            wasm_i32x4_make(
+                m[0].agent_id, m[1].agent_id, m[2].agent_id, m[3].agent_id),
+            own_id);
+        wasm_v128_store(out + i, wasm_v128_andnot(score, own));
+    }
+#endif
+    for (; i < n_missiles; i++) {
+        const float offset = fabsf(twsfw_sdk_dot(r, missiles[i].u));
+        const float course = fmaxf(0.F, 1.F - (offset / radius));
+        const float closeness = 1.F + twsfw_sdk_dot(r, missiles[i].r);
+        const float score = course * closeness * missiles[i].v;
+        out[i] = missiles[i].agent_id == id ? 0.F : score;
+    }
+}
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
@@ -1,14 +1,20 @@
 #pragma once
 
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "twsfw/physx.hpp"
+#include "twsfw/queries.hpp"
 #include "twsfw/twsfw_agent.h"
 #include "twsfw/twsfw_export.hpp"
 #include "twsfw/wasm_agent.hpp"
+#include "twsfw/world_buffer.hpp"
 
 namespace twsfw
 {
@@ -26,10 +32,50 @@ class TWSFW_EXPORT Game final
         float missile_max_velocity;
     };
 
+    // Per-agent budget. The reservation and guard sizes are the virtual
+    // address space set aside for each linear memory and are what limits the
+    // number of agents per host; memory_size limits what is actually used.
+    struct Limits
+    {
+        size_t memory_size;
+        size_t table_elements;
+        size_t memory_reservation;
+        size_t memory_reservation_for_growth;
+        size_t memory_guard_size;
+    };
+
+    // What an agent keeps doing on ticks where it is not asked to decide.
+    // Either way a FIRE is not repeated, so every decision fires at most one
+    // missile.
+    enum class ActionPolicy
+    {
+        hold,  // repeat the last action unchanged
+        decay,  // scale the last action's value down every tick
+    };
+
+    // Outcome of Game::advance.
+    struct Summary
+    {
+        size_t ticks;
+        size_t agents_alive;
+        size_t teams_alive;
+        std::vector<float> team_hp;
+    };
+
   private:
-    void *m_engine = nullptr;
-    void *m_store = nullptr;
+    struct Action
+    {
+        int32_t type;
+        float value;
+    };
+
+    // Owning handle to a wasmtime object, kept opaque in this header.
+    using Handle = std::unique_ptr<void, void (*)(void *)>;
+
+    Handle m_engine;
+    Handle m_store;
     void *m_context = nullptr;
+    Handle m_linker;
 
     Physx m_physx;
     World m_world;
@@ -40,21 +86,89 @@ class TWSFW_EXPORT Game final
 
     std::vector<float> m_missile_cooldown;
 
-    [[nodiscard]] WASMAgent make_agent(
-        const std::basic_string<uint8_t> &wasm) const;
+    size_t m_tick = 0;
+    std::vector<size_t> m_decision_intervals;
+    std::vector<Action> m_actions;
+    ActionPolicy m_action_policy = ActionPolicy::hold;
+    float m_action_decay = .5F;
+
+    // The serialized world of the last decision tick. Teams remember the
+    // version they were last synced to, so only newer chunks are copied into
+    // their input regions.
+    WorldBuffer m_world_buffer;
+    std::vector<size_t> m_offsets;
+    std::vector<size_t> m_chunk_ends;
+    std::vector<size_t> m_synced_versions;
+
+    size_t m_bytes_copied = 0;
+    size_t m_total_bytes_copied = 0;
+
+    // Answers the host queries of agents deciding on the current tick.
+    Snapshot m_snapshot;
+
+    std::vector<std::chrono::nanoseconds> m_compile_times;
+
+    void define_host_queries();
+
+    std::vector<void *> compile_agents(
+        const std::vector<std::basic_string<uint8_t>> &wasm_agents);
+
+    [[nodiscard]] WASMAgent make_agent(void *module) const;
+
+    [[nodiscard]] twsfw_agent export_agent(size_t agent_idx) const;
+
+    [[nodiscard]] twsfw_missile export_missile(size_t missile_idx) const;
+
+    void serialize_world(std::vector<uint8_t> &buffer,
+                         std::vector<size_t> &offsets) const;
 
-    std::vector<size_t> serialize_world(std::vector<uint8_t> &buffer) const;
+    void update_world();
 
-    void call_agent(size_t team,
-                    const std::vector<uint8_t> &buffer,
-                    const std::vector<size_t> &offsets);
+    bool reserve_input(size_t team);
+
+    void sync_world(size_t team, uint8_t *input);
+
+    void call_agent(size_t team);
+
+    [[nodiscard]] bool is_decision_tick(size_t team) const;
+
+    void replay_actions(size_t team);
+
+    bool apply_action(size_t agent_idx, const Action &action);
+
+    void step(float t, int32_t n_steps);
+
+    void summarize(Summary &summary) const;
 
   public:
+    // Applies default limits: 64 MiB of linear memory and 10'000 table
+    // elements per agent, with a 64 MiB reservation, 16 MiB for growth and a
+    // 64 KiB guard. Agents needing more fail to instantiate or to grow.
     explicit Game(const std::vector<std::basic_string<uint8_t>> &wasm_agents,
                   size_t agent_multiplicity,
                   const World &world,
                   size_t ticks_per_second);
 
+    explicit Game(const std::vector<std::basic_string<uint8_t>> &wasm_agents,
+                  size_t agent_multiplicity,
+                  const World &world,
+                  size_t ticks_per_second,
+                  const Limits &limits);
+
+    // Builds the game on another thread, e.g. while the current match runs.
+    static std::future<Game> create(
+        std::vector<std::basic_string<uint8_t>> wasm_agents,
+        size_t agent_multiplicity,
+        const World &world,
+        size_t ticks_per_second);
+
+    static std::future<Game> create(
+        std::vector<std::basic_string<uint8_t>> wasm_agents,
+        size_t agent_multiplicity,
+        const World &world,
+        size_t ticks_per_second,
+        const Limits &limits);
+
     Game(const Game &) = delete;
 
     Game(Game &&other) noexcept;
@@ -65,11 +179,46 @@ class TWSFW_EXPORT Game final
 
     ~Game();
 
+    // Agents of a team are only called every `interval` ticks. Teams are
+    // staggered so that not all of them decide on the same tick.
+    void set_decision_interval(size_t interval);
+
+    void set_decision_interval(size_t team, size_t interval);
+
+    void set_action_policy(ActionPolicy policy, float decay = .5F);
+
+    // Bytes of serialized world copied into agent memories during the last
+    // tick and since the start of the game.
+    [[nodiscard]] size_t bytes_copied() const;
+
+    [[nodiscard]] size_t total_bytes_copied() const;
+
+    // Time it took to compile each team's module. Modules are compiled in
+    // parallel, so these do not add up to the construction time.
+    [[nodiscard]] const std::vector<std::chrono::nanoseconds> &compile_times()
+        const;
+
+    // Largest linear memory size in bytes seen so far, one entry per team.
+    [[nodiscard]] std::vector<size_t> agent_peak_memory() const;
+
     struct State
     {
         std::vector<twsfw_agent> agents;
         std::vector<twsfw_missile> missiles;
     };
     State tick(float t, int32_t n_steps);
+
+    using StopCondition = std::function<bool(const Summary &)>;
+
+    static bool one_team_left(const Summary &summary);
+
+    static bool all_dead(const Summary &summary);
+
+    // Runs up to `n_ticks` ticks without building a State for each of them.
+    // If given, `stop` is checked after every tick and ends the run early.
+    Summary advance(size_t n_ticks,
+                    float t,
+                    int32_t n_steps,
+                    const StopCondition &stop = {});
 };
 }  // namespace twsfw
@@ -5,9 +5,11 @@
 
 #include <twsfwphysx/twsfwphysx.h>
 
+#include "twsfw/twsfw_export.hpp"
+
 namespace twsfw
 {
-class Physx final
+class TWSFW_EXPORT Physx final
 {
     twsfwphysx_agents m_agents;
     twsfwphysx_missiles m_missiles;
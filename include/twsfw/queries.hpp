@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "twsfw/physx.hpp"
+#include "twsfw/twsfw_export.hpp"
+
+namespace twsfw
+{
+// Geometric queries agents can call as host functions. Agents live on the
+// unit sphere, so distances are angles and an agent heading along the great
+// circle with normal u at position r moves towards u x r.
+//
+// Queries are answered from a copy of the world taken once per tick, so all
+// agents deciding on a tick see the same world regardless of call order. The
+// copy is laid out as structure of arrays: every query first scores all
+// entities in a loop the compiler vectorizes and then picks the best score.
+class TWSFW_EXPORT Snapshot final
+{
+    struct Bodies
+    {
+        std::vector<float> rx, ry, rz;  // position
+        std::vector<float> ux, uy, uz;  // normal of the great circle
+        std::vector<float> hx, hy, hz;  // heading, u x r
+
+        void resize(size_t size);
+    };
+
+    Bodies m_agents;
+    std::vector<float> m_agent_hp;
+    std::vector<int32_t> m_agent_team;
+
+    Bodies m_missiles;
+    std::vector<float> m_missile_v;
+    std::vector<int32_t> m_missile_owner;
+
+    float m_agent_radius = 0.F;
+
+    mutable std::vector<float> m_scores;
+
+  public:
+    void capture(const Physx &physx, size_t agents_multiplicity);
+
+    // Index of the closest living agent of another team, or -1 if there is
+    // none.
+    [[nodiscard]] int32_t nearest_enemy(size_t agent_idx) const;
+
+    // Index of the first living agent a missile fired by `agent_idx` would
+    // hit, or -1 if there is none.
+    [[nodiscard]] int32_t raycast(size_t agent_idx) const;
+
+    // Time until the first missile of another agent on a collision course
+    // reaches `agent_idx`, or -1 if there is none. Measured in the units of
+    // the missiles' velocity; missile acceleration is ignored.
+    [[nodiscard]] float time_to_impact(size_t agent_idx) const;
+};
+}  // namespace twsfw
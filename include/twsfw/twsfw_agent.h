@@ -46,7 +46,10 @@ enum twsfw_action_type : uint8_t
     FIRE = 2
 };
 
-float twsfw_agent_act(struct twsfw_agent *agents,
+/* Called once per agent on every decision tick. The input arrays are owned
+ * by the host and only the parts that changed since the last call are
+ * rewritten, so agents must not write to them. */
+float twsfw_agent_act(const struct twsfw_agent *agents,
                       int32_t n_agents,
                       const struct twsfw_missile *missiles,
                       int32_t n_missiles,
@@ -55,6 +58,37 @@ float twsfw_agent_act(struct twsfw_agent *agents,
                       int32_t id,
                       int32_t *action);
 
+/* Optional. Returns a buffer of `n_bytes` the host keeps the agent's input
+ * in, apart from the agent's own data. The host asks again whenever the
+ * input outgrows it. Agents without it get their input written to the start
+ * of their memory, in full, on every call. */
+void *twsfw_agent_alloc(int32_t n_bytes);
+
+/* Host functions agents may import. They run natively on the world as it was
+ * at the start of the tick, so one call replaces a loop over the serialized
+ * arrays. `id` is an index into the agents array. */
+#if defined(__wasm__)
+#define TWSFW_HOST_IMPORT(name) \
+    __attribute__((import_module("env"), import_name(#name)))
+#else
+#define TWSFW_HOST_IMPORT(name)
+#endif
+
+/* Index of the closest living agent of another team, or -1. */
+TWSFW_HOST_IMPORT(twsfw_host_nearest)
+int32_t twsfw_host_nearest(int32_t id);
+
+/* Index of the first living agent a missile fired by `id` now would hit,
+ * or -1. */
+TWSFW_HOST_IMPORT(twsfw_host_raycast)
+int32_t twsfw_host_raycast(int32_t id);
+
+/* Time until the first missile of another agent on a collision course
+ * reaches `id`, in units of the missiles' velocity, or -1. Missile
+ * acceleration is ignored. */
+TWSFW_HOST_IMPORT(twsfw_host_time_to_impact)
+float twsfw_host_time_to_impact(int32_t id);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
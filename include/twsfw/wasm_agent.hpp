@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 namespace twsfw
@@ -9,6 +10,12 @@ struct WASMAgent
     void *module;
     void *instance;
     void *func;
-    uint8_t *memory;
+    void *memory;
+    size_t peak_memory;
+
+    // Optional twsfw_agent_alloc export and the input region it returned.
+    void *alloc;
+    uint32_t input_offset;
+    size_t input_capacity;
 };
 }  // namespace twsfw
\ No newline at end of file
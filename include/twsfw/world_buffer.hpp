@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "twsfw/twsfw_export.hpp"
+
+namespace twsfw
+{
+// Serialized world shared by all teams. The bytes from `begin` on are split
+// into chunks, and every chunk keeps the version in which it last changed, so
+// a reader synced to an older version only needs the newer chunks. Two
+// buffers are kept and swapped, so serializing does not allocate once they
+// have grown.
+class TWSFW_EXPORT WorldBuffer final
+{
+    std::vector<uint8_t> m_buffer;
+    std::vector<uint8_t> m_next;
+    size_t m_begin = 0;
+    std::vector<size_t> m_chunk_ends;
+    std::vector<size_t> m_chunk_versions;
+    size_t m_version = 0;
+    size_t m_layout_version = 0;
+
+  public:
+    // Empty buffer to serialize the next version into.
+    std::vector<uint8_t> &next();
+
+    // Publishes the buffer returned by next(). Chunk i spans up to
+    // chunk_ends[i]; a change of the chunks is a change of layout.
+    void publish(size_t begin, const std::vector<size_t> &chunk_ends);
+
+    // Copies all chunks changed after `synced_version` to the same offsets
+    // in `dst`, everything if the layout changed since. Returns the number
+    // of bytes copied.
+    size_t copy_since(size_t synced_version, uint8_t *dst) const;
+
+    [[nodiscard]] size_t version() const;
+
+    [[nodiscard]] const std::vector<uint8_t> &data() const;
+};
+}  // namespace twsfw
@@ -1,13 +1,17 @@
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <cstring>
+#include <future>
 #include <iostream>
 #include <numbers>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -34,10 +38,10 @@ wasmtime_instance_t *get_agent_instance(const ::twsfw::WASMAgent &agent)
     return static_cast<wasmtime_instance_t *>(agent.instance);
 }
 
-uint8_t *get_agent_memory(const ::twsfw::WASMAgent &agent)
+const wasmtime_memory_t *get_agent_memory(const ::twsfw::WASMAgent &agent)
 {
     assert(agent.memory != nullptr);
-    return agent.memory;
+    return static_cast<wasmtime_memory_t *>(agent.memory);
 }
 
 const wasmtime_func_t *get_agent_func(const ::twsfw::WASMAgent &agent)
@@ -56,6 +60,79 @@ void destroy_agent(::twsfw::WASMAgent &agent)
 
     delete static_cast<wasmtime_extern_t *>(agent.func);
     agent.func = nullptr;
+
+    delete static_cast<wasmtime_memory_t *>(agent.memory);
+    agent.memory = nullptr;
+
+    delete static_cast<wasmtime_extern_t *>(agent.alloc);
+    agent.alloc = nullptr;
+}
+
+void delete_engine(void *engine)
+{
+    wasm_engine_delete(static_cast<wasm_engine_t *>(engine));
+}
+
+void delete_store(void *store)
+{
+    wasmtime_store_delete(static_cast<wasmtime_store_t *>(store));
+}
+
+void delete_linker(void *linker)
+{
+    wasmtime_linker_delete(static_cast<wasmtime_linker_t *>(linker));
+}
+
+// Takes ownership of `error` and returns its message.
+std::string take_message(wasmtime_error_t *error)
+{
+    wasm_name_t message;
+    wasmtime_error_message(error, &message);
+    std::string text(message.data, message.size);
+    wasm_byte_vec_delete(&message);
+    wasmtime_error_delete(error);
+    return text;
+}
+
+// Takes ownership of `trap` and returns its message.
+std::string take_message(wasm_trap_t *trap)
+{
+    wasm_message_t message;
+    wasm_trap_message(trap, &message);
+    std::string text(message.data, message.size);
+    wasm_byte_vec_delete(&message);
+    wasm_trap_delete(trap);
+    return text;
+}
+
+// Host functions find the game through the store's data, see
+// Game::define_host_queries.
+const ::twsfw::Game &get_game(wasmtime_caller_t *caller)
+{
+    return *static_cast<const ::twsfw::Game *>(
+        wasmtime_context_get_data(wasmtime_caller_context(caller)));
+}
+
+// Small reservations keep thousands of agents within the address space, at
+// the cost of explicit bounds checks and of memories moving when they grow.
+constexpr ::twsfw::Game::Limits default_limits{
+    .memory_size = size_t{64} << 20U,
+    .table_elements = 10'000,
+    .memory_reservation = size_t{64} << 20U,
+    .memory_reservation_for_growth = size_t{16} << 20U,
+    .memory_guard_size = size_t{64} << 10U};
+
+wasm_engine_t *make_engine(const ::twsfw::Game::Limits &limits)
+{
+    wasm_config_t *config = wasm_config_new();
+    assert(config != nullptr);
+
+    wasmtime_config_memory_reservation_set(config, limits.memory_reservation);
+    wasmtime_config_memory_reservation_for_growth_set(
+        config, limits.memory_reservation_for_growth);
+    wasmtime_config_memory_guard_size_set(config, limits.memory_guard_size);
+
+    return wasm_engine_new_with_config(config);
 }
 }  // namespace
 
@@ -65,7 +142,22 @@ Game::Game(const std::vector<std::basic_string<uint8_t>> &wasm_agents,
            const size_t agent_multiplicity,
            const World &world,
            const size_t ticks_per_second)
-    : m_engine(wasm_engine_new())
+    : Game(wasm_agents,
+           agent_multiplicity,
+           world,
+           ticks_per_second,
+           default_limits)
+{
+}
+
+Game::Game(const std::vector<std::basic_string<uint8_t>> &wasm_agents,
+           const size_t agent_multiplicity,
+           const World &world,
+           const size_t ticks_per_second,
+           const Limits &limits)
+    : m_engine(make_engine(limits), delete_engine)
+    , m_store(nullptr, delete_store)
+    , m_linker(nullptr, delete_linker)
     , m_physx(Physx(
           wasm_agents.size() * agent_multiplicity,
           {.restitution = world.restitution,
@@ -76,6 +168,10 @@ Game::Game(const std::vector<std::basic_string<uint8_t>> &wasm_agents,
     , m_ticks_per_second(ticks_per_second)
     , m_agents_multiplicity(agent_multiplicity)
     , m_missile_cooldown(m_agents_multiplicity * wasm_agents.size(), 0.F)
+    , m_decision_intervals(wasm_agents.size(), 1)
+    , m_actions(m_agents_multiplicity * wasm_agents.size(),
+                {.type = ROTATE, .value = 0.F})
+    , m_synced_versions(wasm_agents.size(), 0)
 {
     m_world.agent_healing_rate /= static_cast<float>(ticks_per_second);
     m_world.agent_cooldown /= static_cast<float>(ticks_per_second);
@@ -85,14 +181,42 @@ Game::Game(const std::vector<std::basic_string<uint8_t>> &wasm_agents,
 
     assert(m_engine != nullptr);
 
-    m_store = wasmtime_store_new(
-        static_cast<wasm_engine_t *>(m_engine), nullptr, nullptr);
+    m_store.reset(wasmtime_store_new(
+        static_cast<wasm_engine_t *>(m_engine.get()), nullptr, nullptr));
     assert(m_store != nullptr);
     m_context =
-        wasmtime_store_context(static_cast<wasmtime_store_t *>(m_store));
-
-    for (const auto &wasm : wasm_agents) {
-        m_wasm_agents.emplace_back(make_agent(wasm));
+        wasmtime_store_context(static_cast<wasmtime_store_t *>(m_store.get()));
+    wasmtime_context_set_data(static_cast<wasmtime_context_t *>(m_context),
+                              this);
+
+    wasmtime_store_limiter(static_cast<wasmtime_store_t *>(m_store.get()),
+                           static_cast<int64_t>(limits.memory_size),
+                           static_cast<int64_t>(limits.table_elements),
+                           static_cast<int64_t>(wasm_agents.size()),
+                           -1,
+                           -1);
+
+    m_linker.reset(
+        wasmtime_linker_new(static_cast<wasm_engine_t *>(m_engine.get())));
+    assert(m_linker != nullptr);
+    define_host_queries();
+
+    const auto modules = compile_agents(wasm_agents);
+    m_wasm_agents.reserve(modules.size());
+    for (auto i = 0U; i < modules.size(); i++) {
+        try {
+            m_wasm_agents.emplace_back(make_agent(modules[i]));
+        } catch (...) {
+            // The destructor does not run for a throwing constructor.
+            for (auto &agent : m_wasm_agents) {
+                destroy_agent(agent);
+            }
+            for (auto j = i; j < modules.size(); j++) {
+                wasmtime_module_delete(
+                    static_cast<wasmtime_module_t *>(modules[j]));
+            }
+            throw;
+        }
     }
 
     for (auto i = 0U; i < m_physx.agents_size(); i++) {
@@ -107,37 +231,111 @@ Game::Game(const std::vector<std::basic_string<uint8_t>> &wasm_agents,
     }
 }
 
+std::future<Game> Game::create(
+    std::vector<std::basic_string<uint8_t>> wasm_agents,
+    const size_t agent_multiplicity,
+    const World &world,
+    const size_t ticks_per_second)
+{
+    return create(std::move(wasm_agents),
+                  agent_multiplicity,
+                  world,
+                  ticks_per_second,
+                  default_limits);
+}
+
+std::future<Game> Game::create(
+    std::vector<std::basic_string<uint8_t>> wasm_agents,
+    const size_t agent_multiplicity,
+    const World &world,
+    const size_t ticks_per_second,
+    const Limits &limits)
+{
+    return std::async(
+        std::launch::async,
+        [wasm_agents = std::move(wasm_agents),
+         agent_multiplicity,
+         world,
+         ticks_per_second,
+         limits]
+        {
+            return Game{wasm_agents,
+                        agent_multiplicity,
+                        world,
+                        ticks_per_second,
+                        limits};
+        });
+}
+
 Game::Game(Game &&other) noexcept
-    : m_engine(other.m_engine)
-    , m_store(other.m_store)
+    : m_engine(std::move(other.m_engine))
+    , m_store(std::move(other.m_store))
     , m_context(other.m_context)
+    , m_linker(std::move(other.m_linker))
     , m_physx(std::move(other.m_physx))
     , m_world(other.m_world)
     , m_ticks_per_second(other.m_ticks_per_second)
     , m_wasm_agents(std::move(other.m_wasm_agents))
     , m_agents_multiplicity(other.m_agents_multiplicity)
     , m_missile_cooldown(std::move(other.m_missile_cooldown))
+    , m_tick(other.m_tick)
+    , m_decision_intervals(std::move(other.m_decision_intervals))
+    , m_actions(std::move(other.m_actions))
+    , m_action_policy(other.m_action_policy)
+    , m_action_decay(other.m_action_decay)
+    , m_world_buffer(std::move(other.m_world_buffer))
+    , m_offsets(std::move(other.m_offsets))
+    , m_chunk_ends(std::move(other.m_chunk_ends))
+    , m_synced_versions(std::move(other.m_synced_versions))
+    , m_bytes_copied(other.m_bytes_copied)
+    , m_total_bytes_copied(other.m_total_bytes_copied)
+    , m_snapshot(std::move(other.m_snapshot))
+    , m_compile_times(std::move(other.m_compile_times))
 {
+    other.m_context = nullptr;
+
+    // Host functions find the game through the store's data.
+    if (m_context != nullptr) {
+        wasmtime_context_set_data(static_cast<wasmtime_context_t *>(m_context),
+                                  this);
+    }
 }
 
 Game &Game::operator=(Game &&other) noexcept
 {
     if (this != &other) {
-        m_engine = other.m_engine;
-        other.m_engine = nullptr;
-
-        m_store = other.m_store;
-        other.m_store = nullptr;
-
-        m_context = other.m_context;
-        other.m_context = nullptr;
+        // Swap the WASM runtime so `other` releases the one we held before.
+        std::swap(m_engine, other.m_engine);
+        std::swap(m_store, other.m_store);
+        std::swap(m_context, other.m_context);
+        std::swap(m_linker, other.m_linker);
+        std::swap(m_wasm_agents, other.m_wasm_agents);
+
+        for (auto *game : {this, &other}) {
+            if (game->m_context != nullptr) {
+                wasmtime_context_set_data(
+                    static_cast<wasmtime_context_t *>(game->m_context), game);
+            }
+        }
 
         m_physx = std::move(other.m_physx);
         m_world = other.m_world;
         m_ticks_per_second = other.m_ticks_per_second;
-        m_wasm_agents = std::move(other.m_wasm_agents);
         m_agents_multiplicity = other.m_agents_multiplicity;
         m_missile_cooldown = std::move(other.m_missile_cooldown);
+        m_tick = other.m_tick;
+        m_decision_intervals = std::move(other.m_decision_intervals);
+        m_actions = std::move(other.m_actions);
+        m_action_policy = other.m_action_policy;
+        m_action_decay = other.m_action_decay;
+        m_world_buffer = std::move(other.m_world_buffer);
+        m_offsets = std::move(other.m_offsets);
+        m_chunk_ends = std::move(other.m_chunk_ends);
+        m_synced_versions = std::move(other.m_synced_versions);
+        m_bytes_copied = other.m_bytes_copied;
+        m_total_bytes_copied = other.m_total_bytes_copied;
+        m_snapshot = std::move(other.m_snapshot);
+        m_compile_times = std::move(other.m_compile_times);
     }
 
     return *this;
@@ -148,35 +346,217 @@ Game::~Game()
     for (auto &agent : m_wasm_agents) {
         destroy_agent(agent);
     }
+}
 
-    wasmtime_store_delete(static_cast<wasmtime_store_t *>(m_store));
-    wasm_engine_delete(static_cast<wasm_engine_t *>(m_engine));
+void Game::set_decision_interval(const size_t interval)
+{
+    for (auto team = 0U; team < m_decision_intervals.size(); team++) {
+        set_decision_interval(team, interval);
+    }
 }
 
-WASMAgent Game::make_agent(const std::basic_string<uint8_t> &wasm) const
+void Game::set_decision_interval(const size_t team, const size_t interval)
 {
-    auto *ctx = static_cast<wasmtime_context_t *>(m_context);
+    assert(team < m_decision_intervals.size());
+    m_decision_intervals[team] = std::max(interval, size_t{1});
+}
+
+void Game::set_action_policy(const ActionPolicy policy, const float decay)
+{
+    assert(decay >= 0.F and decay <= 1.F);
+    m_action_policy = policy;
+    m_action_decay = decay;
+}
+
+size_t Game::bytes_copied() const
+{
+    return m_bytes_copied;
+}
 
-    wasmtime_module_t *module = nullptr;
-    const auto *error =
-        wasmtime_module_new(static_cast<wasm_engine_t *>(m_engine),
-                            wasm.data(),
-                            wasm.size(),
-                            &module);
-    if (error != nullptr or module == nullptr) {
-        throw std::runtime_error("Could not build WASM module");
+size_t Game::total_bytes_copied() const
+{
+    return m_total_bytes_copied;
+}
+
+const std::vector<std::chrono::nanoseconds> &Game::compile_times() const
+{
+    return m_compile_times;
+}
+
+std::vector<size_t> Game::agent_peak_memory() const
+{
+    std::vector<size_t> peaks;
+    peaks.reserve(m_wasm_agents.size());
+    for (const auto &agent : m_wasm_agents) {
+        peaks.emplace_back(agent.peak_memory);
     }
 
-    auto *instance = new wasmtime_instance_t{};
+    return peaks;
+}
+
+void Game::define_host_queries()
+{
+    auto *linker = static_cast<wasmtime_linker_t *>(m_linker.get());
+
+    auto define = [linker](const std::string &name,
+                           wasm_functype_t *type,
+                           wasmtime_func_callback_t callback)
+    {
+        auto *error = wasmtime_linker_define_func(linker,
+                                                  "env",
+                                                  strlen("env"),
+                                                  name.data(),
+                                                  name.size(),
+                                                  type,
+                                                  callback,
+                                                  nullptr,
+                                                  nullptr);
+        wasm_functype_delete(type);
+        if (error != nullptr) {
+            throw std::runtime_error("Could not define host function " + name
+                                     + ": " + take_message(error));
+        }
+    };
+
+    // Callbacks are captureless lambdas so they may access the game's
+    // internals. They answer from m_snapshot, not from the live world.
+    define("twsfw_host_nearest",
+           wasm_functype_new_1_1(wasm_valtype_new_i32(),
+                                 wasm_valtype_new_i32()),
+           [](void *,
+              wasmtime_caller_t *caller,
+              const wasmtime_val_t *args,
+              size_t,
+              wasmtime_val_t *results,
+              size_t) -> wasm_trap_t *
+           {
+               const auto &game = get_game(caller);
+               const auto agent_idx = static_cast<size_t>(args[0].of.i32);
+               results[0].kind = WASMTIME_I32;
+               results[0].of.i32 = game.m_snapshot.nearest_enemy(agent_idx);
+               return nullptr;
+           });
+
+    define("twsfw_host_raycast",
+           wasm_functype_new_1_1(wasm_valtype_new_i32(),
+                                 wasm_valtype_new_i32()),
+           [](void *,
+              wasmtime_caller_t *caller,
+              const wasmtime_val_t *args,
+              size_t,
+              wasmtime_val_t *results,
+              size_t) -> wasm_trap_t *
+           {
+               const auto &game = get_game(caller);
+               const auto agent_idx = static_cast<size_t>(args[0].of.i32);
+               results[0].kind = WASMTIME_I32;
+               results[0].of.i32 = game.m_snapshot.raycast(agent_idx);
+               return nullptr;
+           });
+
+    define("twsfw_host_time_to_impact",
+           wasm_functype_new_1_1(wasm_valtype_new_i32(),
+                                 wasm_valtype_new_f32()),
+           [](void *,
+              wasmtime_caller_t *caller,
+              const wasmtime_val_t *args,
+              size_t,
+              wasmtime_val_t *results,
+              size_t) -> wasm_trap_t *
+           {
+               const auto &game = get_game(caller);
+               const auto agent_idx = static_cast<size_t>(args[0].of.i32);
+               results[0].kind = WASMTIME_F32;
+               results[0].of.f32 =
+                   game.m_snapshot.time_to_impact(agent_idx);
+               return nullptr;
+           });
+}
+
+std::vector<void *> Game::compile_agents(
+    const std::vector<std::basic_string<uint8_t>> &wasm_agents)
+{
+    // Compilation only needs the engine, which is thread-safe. Instantiation
+    // uses the store and has to stay on this thread.
+    std::vector<void *> modules(wasm_agents.size(), nullptr);
+    std::vector<std::string> errors(wasm_agents.size());
+    m_compile_times.assign(wasm_agents.size(), {});
+
+    std::atomic<size_t> next{0};
+    auto compile = [&]
+    {
+        for (auto i = next++; i < wasm_agents.size(); i = next++) {
+            const auto start = std::chrono::steady_clock::now();
+
+            wasmtime_module_t *module = nullptr;
+            auto *error = wasmtime_module_new(
+                static_cast<wasm_engine_t *>(m_engine.get()),
+                wasm_agents[i].data(),
+                wasm_agents[i].size(),
+                &module);
+            if (error != nullptr) {
+                errors[i] = take_message(error);
+            } else {
+                modules[i] = module;
+            }
+
+            m_compile_times[i] = std::chrono::steady_clock::now() - start;
+        }
+    };
+
+    {
+        const auto n_cores = std::max(std::thread::hardware_concurrency(), 1U);
+        const auto n_threads = std::min<size_t>(wasm_agents.size(), n_cores);
+        std::vector<std::jthread> threads;
+        for (auto i = 1U; i < n_threads; i++) {
+            threads.emplace_back(compile);
+        }
+        compile();
+    }
+
+    const auto failed = std::ranges::find(modules, nullptr);
+    if (failed != modules.end()) {
+        for (auto *module : modules) {
+            if (module != nullptr) {
+                wasmtime_module_delete(
+                    static_cast<wasmtime_module_t *>(module));
+            }
+        }
+
+        const auto i = static_cast<size_t>(failed - modules.begin());
+        throw std::runtime_error("Could not build WASM module "
+                                 + std::to_string(i) + ": " + errors[i]);
+    }
+
+    return modules;
+}
+
+WASMAgent Game::make_agent(void *agent_module) const
+{
+    auto *ctx = static_cast<wasmtime_context_t *>(m_context);
+    auto *module = static_cast<wasmtime_module_t *>(agent_module);
+
+    // The module stays owned by the caller if this throws.
+    auto instance = std::make_unique<wasmtime_instance_t>();
     wasm_trap_t *trap = nullptr;
-    error = wasmtime_instance_new(ctx, module, nullptr, 0, instance, &trap);
-    if (error != nullptr or trap != nullptr) {
-        throw std::runtime_error("Could not instantiate WASM module");
+    const auto *linker = static_cast<wasmtime_linker_t *>(m_linker.get());
+    auto *error = wasmtime_linker_instantiate(
+        linker, ctx, module, instance.get(), &trap);
+    if (error != nullptr) {
+        throw std::runtime_error("Could not instantiate WASM module: "
+                                 + take_message(error));
+    }
+    if (trap != nullptr) {
+        throw std::runtime_error("Could not instantiate WASM module: "
+                                 + take_message(trap));
     }
 
-    auto *func = new wasmtime_extern_t{};
-    bool ok = wasmtime_instance_export_get(
-        ctx, instance, "twsfw_agent_act", strlen("twsfw_agent_act"), func);
+    auto func = std::make_unique<wasmtime_extern_t>();
+    bool ok = wasmtime_instance_export_get(ctx,
+                                           instance.get(),
+                                           "twsfw_agent_act",
+                                           strlen("twsfw_agent_act"),
+                                           func.get());
     if (not ok or func->kind != WASMTIME_EXTERN_FUNC) {
         throw std::runtime_error(
             "Could not find twsfw_agent_act in WASM module");
@@ -184,46 +564,117 @@ WASMAgent Game::make_agent(const std::basic_string<uint8_t> &wasm) const
 
     wasmtime_extern_t item;
     ok = wasmtime_instance_export_get(
-        ctx, instance, "memory", strlen("memory"), &item);
+        ctx, instance.get(), "memory", strlen("memory"), &item);
     assert(ok && item.kind == WASMTIME_EXTERN_MEMORY);
-    const wasmtime_memory_t memory = item.of.memory;
-    uint8_t *memory_data = wasmtime_memory_data(ctx, &memory);
+    auto *memory = new wasmtime_memory_t{item.of.memory};
+
+    auto *alloc = new wasmtime_extern_t{};
+    ok = wasmtime_instance_export_get(ctx,
+                                      instance.get(),
+                                      "twsfw_agent_alloc",
+                                      strlen("twsfw_agent_alloc"),
+                                      alloc);
+    if (not ok or alloc->kind != WASMTIME_EXTERN_FUNC) {
+        delete alloc;
+        alloc = nullptr;
+    }
 
     return {.module = module,
-            .instance = instance,
-            .func = func,
-            .memory = memory_data};
+            .instance = instance.release(),
+            .func = func.release(),
+            .memory = memory,
+            .peak_memory = wasmtime_memory_data_size(ctx, memory),
+            .alloc = alloc,
+            .input_offset = 0,
+            .input_capacity = 0};
+}
+
+twsfw_agent Game::export_agent(const size_t agent_idx) const
+{
+    const auto &agent = m_physx.get_agents()[agent_idx];
+
+    twsfw_agent exported{};
+    exported.r.x = agent.r.x;
+    exported.r.y = agent.r.y;
+    exported.r.z = agent.r.z;
+
+    exported.u.x = agent.u.x;
+    exported.u.y = agent.u.y;
+    exported.u.z = agent.u.z;
+
+    exported.v = agent.v;
+    exported.a = agent.a;
+    exported.hp = static_cast<int32_t>(std::lround(agent.hp));
+    exported.team = static_cast<int32_t>(agent_idx / m_agents_multiplicity);
+
+    return exported;
 }
 
-std::vector<size_t> Game::serialize_world(std::vector<uint8_t> &buffer) const
+twsfw_missile Game::export_missile(const size_t missile_idx) const
 {
-    std::vector<size_t> offsets;
+    const auto &missile = m_physx.get_missiles()[missile_idx];
+
+    twsfw_missile exported{};
+    exported.r.x = missile.r.x;
+    exported.r.y = missile.r.y;
+    exported.r.z = missile.r.z;
+
+    exported.u.x = missile.u.x;
+    exported.u.y = missile.u.y;
+    exported.u.z = missile.u.z;
+
+    exported.v = missile.v;
+    exported.agent_id = missile.payload;
 
+    return exported;
+}
+
+void Game::serialize_world(std::vector<uint8_t> &buffer,
+                           std::vector<size_t> &offsets) const
+{
+    offsets.clear();
+
+    // Agents see the layout declared in twsfw_agent.h, not the one of
+    // twsfwphysx.
     auto offset = buffer.size();
     {
-        const auto &agents = m_physx.get_agents();
-        const auto n_bytes = agents.size() * sizeof(agents.front());
+        const auto n_agents = m_physx.agents_size();
+        const auto n_bytes = n_agents * sizeof(twsfw_agent);
 
         buffer.resize(offset + n_bytes);
-        std::memcpy(buffer.data() + offset, agents.data(), n_bytes);
+        for (auto i = 0U; i < n_agents; i++) {
+            const auto agent = export_agent(i);
+            std::memcpy(buffer.data() + offset + (i * sizeof(agent)),
+                        &agent,
+                        sizeof(agent));
+        }
 
         offsets.emplace_back(offset);
         offset += n_bytes;
     }
 
     {
-        const auto &missiles = m_physx.get_missiles();
-        const auto n_bytes = missiles.size() * sizeof(missiles.front());
+        const auto n_missiles = m_physx.missiles_size();
+        const auto n_bytes = n_missiles * sizeof(twsfw_missile);
 
         buffer.resize(offset + n_bytes);
-        std::memcpy(buffer.data() + offset, missiles.data(), n_bytes);
+        for (auto i = 0U; i < n_missiles; i++) {
+            const auto missile = export_missile(i);
+            std::memcpy(buffer.data() + offset + (i * sizeof(missile)),
+                        &missile,
+                        sizeof(missile));
+        }
 
         offsets.emplace_back(offset);
         offset += n_bytes;
     }
 
     {
-        const auto &world = m_physx.get_world();
+        const auto &physx_world = m_physx.get_world();
+        const twsfw_world world{
+            .restitution = physx_world.restitution,
+            .agent_radius = physx_world.agent_radius,
+            .missile_acceleration = physx_world.missile_acceleration};
         constexpr auto n_bytes = sizeof(world);
         buffer.resize(offset + n_bytes);
         std::memcpy(buffer.data() + offset, &world, n_bytes);
@@ -231,17 +682,105 @@ std::vector<size_t> Game::serialize_world(std::vector<uint8_t> &buffer) const
         offsets.emplace_back(offset);
         // offset += n_bytes;
     }
+}
+
+void Game::update_world()
+{
+    auto &buffer = m_world_buffer.next();
+    buffer.resize(sizeof(int32_t));
+    serialize_world(buffer, m_offsets);
+
+    m_chunk_ends.clear();
+    for (auto i = 1U; i <= m_physx.agents_size(); i++) {
+        m_chunk_ends.emplace_back(m_offsets[0] + (i * sizeof(twsfw_agent)));
+    }
+    for (auto i = 1U; i <= m_physx.missiles_size(); i++) {
+        m_chunk_ends.emplace_back(m_offsets[1] + (i * sizeof(twsfw_missile)));
+    }
+    m_chunk_ends.emplace_back(buffer.size());
 
-    return offsets;
+    m_world_buffer.publish(m_offsets[0], m_chunk_ends);
 }
 
-void Game::call_agent(const size_t team,
-                      const std::vector<uint8_t> &buffer,
-                      const std::vector<size_t> &offsets)
+bool Game::reserve_input(const size_t team)
 {
-    std::memcpy(
-        get_agent_memory(m_wasm_agents[team]), buffer.data(), buffer.size());
+    auto *ctx = static_cast<wasmtime_context_t *>(m_context);
+    auto &agent = m_wasm_agents[team];
+    const auto n_bytes = m_world_buffer.data().size();
+
+    // Without twsfw_agent_alloc the input goes to the start of the memory,
+    // where it may overlap the agent's own data, so it is rewritten in full
+    // for every call.
+    if (agent.alloc == nullptr) {
+        m_synced_versions[team] = 0;
+    } else if (agent.input_capacity < n_bytes) {
+        const auto capacity = 2 * n_bytes;
+        const wasmtime_val_t arg{
+            .kind = WASMTIME_I32,
+            .of = {.i32 = static_cast<int32_t>(capacity)}};
+        wasmtime_val_t result{.kind = WASMTIME_I32, .of = {.i32 = 0}};
+        wasm_trap_t *trap = nullptr;
+        auto *error = wasmtime_func_call(
+            ctx,
+            &static_cast<wasmtime_extern_t *>(agent.alloc)->of.func,
+            &arg,
+            1,
+            &result,
+            1,
+            &trap);
+        if (error != nullptr) {
+            wasmtime_error_delete(error);
+        }
+        if (trap != nullptr) {
+            wasm_trap_delete(trap);
+        }
+
+        if (error != nullptr or trap != nullptr or result.of.i32 == 0) {
+            std::cerr << "Team " << team << " could not allocate its input!\n";
+            return false;
+        }
+        agent.input_offset = static_cast<uint32_t>(result.of.i32);
+        agent.input_capacity = capacity;
+        m_synced_versions[team] = 0;
+    }
+
+    const auto memory_size =
+        wasmtime_memory_data_size(ctx, get_agent_memory(agent));
+    if (memory_size < agent.input_offset + n_bytes) {
+        std::cerr << "Team " << team << " has too little memory!\n";
+        return false;
+    }
+
+    return true;
+}
+
+void Game::sync_world(const size_t team, uint8_t *input)
+{
+    auto &synced_version = m_synced_versions[team];
+
+    // The action slot is reset for every call.
+    std::memset(input, 0, m_offsets[0]);
+    const auto n_bytes =
+        m_offsets[0] + m_world_buffer.copy_since(synced_version, input);
+
+    synced_version = m_world_buffer.version();
+    m_bytes_copied += n_bytes;
+    m_total_bytes_copied += n_bytes;
+}
+
+void Game::call_agent(const size_t team)
+{
+    auto *ctx = static_cast<wasmtime_context_t *>(m_context);
+    auto &agent = m_wasm_agents[team];
+
+    if (not reserve_input(team)) {
+        return;
+    }
+    const auto input = agent.input_offset;
+    sync_world(team,
+               wasmtime_memory_data(ctx, get_agent_memory(agent)) + input);
 
+    const auto &offsets = m_offsets;
     assert(offsets.size() == 3);
     auto make_arg = [](auto value)
     {
@@ -253,65 +792,115 @@ void Game::call_agent(const size_t team,
         const auto agent_idx = (team * m_agents_multiplicity) + i;
 
         const std::array args{
-            make_arg(offsets[0]),
+            make_arg(input + offsets[0]),
             make_arg(m_physx.agents_size()),
-            make_arg(offsets[1]),
+            make_arg(input + offsets[1]),
             make_arg(m_physx.missiles_size()),
             make_arg(m_missile_cooldown[agent_idx]),
-            make_arg(offsets[2]),
+            make_arg(input + offsets[2]),
             make_arg(agent_idx),
-            make_arg(0),
+            make_arg(input),
         };
 
-        wasmtime_val_t result;
+        wasmtime_val_t result{.kind = WASMTIME_F32, .of = {.f32 = 0.F}};
         wasm_trap_t *trap = nullptr;
-        const auto *error =
-            wasmtime_func_call(static_cast<wasmtime_context_t *>(m_context),
-                               get_agent_func(m_wasm_agents[team]),
-                               args.data(),
-                               args.size(),
-                               &result,
-                               1,
-                               &trap);
+        auto *error = wasmtime_func_call(ctx,
+                                         get_agent_func(agent),
+                                         args.data(),
+                                         args.size(),
+                                         &result,
+                                         1,
+                                         &trap);
+
+        // The call may have grown the memory, which can move it.
+        agent.peak_memory = std::max(
+            agent.peak_memory,
+            wasmtime_memory_data_size(ctx, get_agent_memory(agent)));
+
         if (error != nullptr or trap != nullptr) {
             std::cerr << "Agent " << agent_idx << " failed!\n";
+            if (error != nullptr) {
+                wasmtime_error_delete(error);
+            }
+            if (trap != nullptr) {
+                wasm_trap_delete(trap);
+            }
+
+            // Do not replay whatever the failed call left behind.
+            m_actions[agent_idx] = {.type = ROTATE, .value = 0.F};
+            continue;
         }
-        const auto action_value = result.of.f32;
 
-        int32_t action_type = 0;
-        std::memcpy(&action_type,
-                    get_agent_memory(m_wasm_agents[team]) + 0,
+        Action action{.type = 0, .value = result.of.f32};
+        std::memcpy(&action.type,
+                    wasmtime_memory_data(ctx, get_agent_memory(agent)) + input,
                     sizeof(int32_t));
 
-        switch (action_type) {
-            case ROTATE: {
-                const auto angle =
-                    std::min(m_world.agent_max_rotation_speed, action_value);
-                m_physx.rotate_agent(agent_idx, angle);
-            } break;
-
-            case ACCELERATE: {
-                const auto max_acceleration = m_world.agent_max_velocity
-                    / static_cast<float>(m_ticks_per_second);
-                const auto a =
-                    std::min(std::max(action_value, 0.F), max_acceleration);
-                m_physx.get_agents()[agent_idx].a = a;
-            } break;
-
-            case FIRE: {
-                if (m_missile_cooldown[agent_idx] <= 0.F) {
-                    m_physx.fire(agent_idx, m_world.missile_max_velocity);
-                }
-            } break;
-
-            default:
-                std::cerr << "Unknown action " << action_type << " from agent "
-                          << agent_idx << '\n';
+        if (not apply_action(agent_idx, action)) {
+            action = {.type = ROTATE, .value = 0.F};
         }
+        m_actions[agent_idx] = action;
     }
 }
 
-Game::State Game::tick(const float t, const int32_t n_steps)
+bool Game::is_decision_tick(const size_t team) const
+{
+    const auto interval = m_decision_intervals[team];
+    const auto offset = team * interval / m_decision_intervals.size();
+    return (m_tick + offset) % interval == 0;
+}
+
+void Game::replay_actions(const size_t team)
+{
+    for (auto i = 0U; i < m_agents_multiplicity; i++) {
+        const auto agent_idx = (team * m_agents_multiplicity) + i;
+        auto &action = m_actions[agent_idx];
+
+        // One decision fires at most one missile.
+        if (action.type == FIRE) {
+            continue;
+        }
+        if (m_action_policy == ActionPolicy::decay) {
+            action.value *= m_action_decay;
+        }
+
+        apply_action(agent_idx, action);
+    }
+}
+
+bool Game::apply_action(const size_t agent_idx, const Action &action)
+{
+    switch (action.type) {
+        case ROTATE: {
+            const auto angle =
+                std::min(m_world.agent_max_rotation_speed, action.value);
+            m_physx.rotate_agent(agent_idx, angle);
+        } break;
+
+        case ACCELERATE: {
+            const auto max_acceleration = m_world.agent_max_velocity
+                / static_cast<float>(m_ticks_per_second);
+            const auto a =
+                std::min(std::max(action.value, 0.F), max_acceleration);
+            m_physx.get_agents()[agent_idx].a = a;
+        } break;
+
+        case FIRE: {
+            if (m_missile_cooldown[agent_idx] <= 0.F) {
+                m_physx.fire(agent_idx, m_world.missile_max_velocity);
+            }
+        } break;
+
+        default:
+            std::cerr << "Unknown action " << action.type << " from agent "
+                      << agent_idx << '\n';
+            return false;
+    }
+
+    return true;
+}
+
+void Game::step(const float t, const int32_t n_steps)
 {
     {
         const auto &agents = m_physx.get_agents();
@@ -326,50 +915,101 @@ Game::State Game::tick(const float t, const int32_t n_steps)
 
     m_physx.simulate(t, n_steps);
 
+    m_bytes_copied = 0;
     {
-        std::vector<uint8_t> buffer(sizeof(int32_t));
-        const auto &offsets = serialize_world(buffer);
+        // All teams deciding on this tick see the same snapshot, taken
+        // before any held action was replayed.
+        std::vector<bool> due(m_wasm_agents.size());
+        for (auto i = 0U; i < m_wasm_agents.size(); i++) {
+            due[i] = is_decision_tick(i);
+        }
+        if (std::ranges::find(due, true) != due.end()) {
+            update_world();
+            m_snapshot.capture(m_physx, m_agents_multiplicity);
+        }
 
         for (auto i = 0U; i < m_wasm_agents.size(); i++) {
-            call_agent(i, buffer, offsets);
+            if (due[i]) {
+                call_agent(i);
+            } else {
+                replay_actions(i);
+            }
         }
     }
+    m_tick++;
+}
+
+Game::State Game::tick(const float t, const int32_t n_steps)
+{
+    step(t, n_steps);
 
     std::vector<twsfw_agent> agents(m_physx.agents_size());
     std::vector<twsfw_missile> missiles(m_physx.missiles_size());
 
-    for (auto i = 0U; i < m_physx.agents_size(); i++) {
-        const auto &agent = m_physx.get_agents()[i];
+    for (auto i = 0U; i < agents.size(); i++) {
+        agents[i] = export_agent(i);
+    }
 
-        agents[i].r.x = agent.r.x;
-        agents[i].r.y = agent.r.y;
-        agents[i].r.z = agent.r.z;
+    for (auto i = 0U; i < missiles.size(); i++) {
+        missiles[i] = export_missile(i);
+    }
 
-        agents[i].u.x = agent.u.x;
-        agents[i].u.y = agent.u.y;
-        agents[i].u.z = agent.u.z;
+    return {.agents = agents, .missiles = missiles};
+}
 
-        agents[i].v = agent.v;
-        agents[i].a = agent.a;
-        agents[i].hp = static_cast<int32_t>(std::lround(agent.hp));
-        agents[i].team = static_cast<int32_t>(i / m_agents_multiplicity);
-    }
+bool Game::one_team_left(const Summary &summary)
+{
+    return summary.teams_alive <= 1;
+}
 
-    for (auto i = 0U; i < m_physx.agents_size(); i++) {
-        const auto &missile = m_physx.get_missiles()[i];
+bool Game::all_dead(const Summary &summary)
+{
+    return summary.agents_alive == 0;
+}
 
-        missiles[i].r.x = missile.r.x;
-        missiles[i].r.y = missile.r.y;
-        missiles[i].r.z = missile.r.z;
+Game::Summary Game::advance(const size_t n_ticks,
+                            const float t,
+                            const int32_t n_steps,
+                            const StopCondition &stop)
+{
+    Summary summary{.ticks = 0,
+                    .agents_alive = 0,
+                    .teams_alive = 0,
+                    .team_hp = std::vector(m_wasm_agents.size(), 0.F)};
+
+    while (summary.ticks < n_ticks) {
+        step(t, n_steps);
+        summary.ticks++;
+
+        if (stop) {
+            summarize(summary);
+            if (stop(summary)) {
+                return summary;
+            }
+        }
+    }
 
-        missiles[i].u.x = missile.u.x;
-        missiles[i].u.y = missile.u.y;
-        missiles[i].u.z = missile.u.z;
+    summarize(summary);
+    return summary;
+}
 
-        missiles[i].v = missile.v;
-        missiles[i].agent_id = missile.payload;
+void Game::summarize(Summary &summary) const
+{
+    summary.agents_alive = 0;
+    summary.teams_alive = 0;
+    std::fill(summary.team_hp.begin(), summary.team_hp.end(), 0.F);
+
+    const auto &agents = m_physx.get_agents();
+    for (auto i = 0U; i < agents.size(); i++) {
+        if (agents[i].hp > 0.F) {
+            summary.agents_alive++;
+            summary.team_hp[i / m_agents_multiplicity] += agents[i].hp;
+        }
     }
 
-    return {.agents = agents, .missiles = missiles};
+    summary.teams_alive = static_cast<size_t>(
+        std::count_if(summary.team_hp.begin(),
+                      summary.team_hp.end(),
+                      [](const float hp) { return hp > 0.F; }));
 }
 }  // namespace twsfw
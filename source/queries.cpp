@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numbers>
+
+#include "twsfw/queries.hpp"
+
+#include <twsfwphysx/twsfwphysx.h>
+
+#include "twsfw/physx.hpp"
+
+namespace
+{
+// Penalty that moves entities a query must not pick out of the range of
+// valid scores.
+constexpr auto rejected = 8.F;
+
+// Monotonic stand-in for the angle of (c, s) in [0, 2pi), mapped to [0, 4).
+// Unlike atan2 it vectorizes. Conditions are turned into 0/1 factors since
+// GCC does not if-convert float comparisons.
+float pseudo_angle(const float c, const float s)
+{
+    const auto cosine = c / (std::abs(c) + std::abs(s) + 1e-12F);
+    const auto upper = static_cast<float>(s >= 0.F);
+    return (upper * (1.F - cosine)) + ((1.F - upper) * (3.F + cosine));
+}
+
+float angle(const float c, const float s)
+{
+    constexpr auto two_pi = 2.F * std::numbers::pi_v<float>;
+    const auto a = std::atan2(s, c);
+    return a < 0.F ? a + two_pi : a;
+}
+}  // namespace
+
+namespace twsfw
+{
+void Snapshot::Bodies::resize(const size_t size)
+{
+    for (auto *v : {&rx, &ry, &rz, &ux, &uy, &uz, &hx, &hy, &hz}) {
+        v->resize(size);
+    }
+}
+
+void Snapshot::capture(const Physx &physx, const size_t agents_multiplicity)
+{
+    const auto &agents = physx.get_agents();
+    m_agents.resize(agents.size());
+    m_agent_hp.resize(agents.size());
+    m_agent_team.resize(agents.size());
+    for (auto i = 0U; i < agents.size(); i++) {
+        const auto &a = agents[i];
+        m_agents.rx[i] = a.r.x;
+        m_agents.ry[i] = a.r.y;
+        m_agents.rz[i] = a.r.z;
+        m_agents.ux[i] = a.u.x;
+        m_agents.uy[i] = a.u.y;
+        m_agents.uz[i] = a.u.z;
+        m_agents.hx[i] = (a.u.y * a.r.z) - (a.u.z * a.r.y);
+        m_agents.hy[i] = (a.u.z * a.r.x) - (a.u.x * a.r.z);
+        m_agents.hz[i] = (a.u.x * a.r.y) - (a.u.y * a.r.x);
+        m_agent_hp[i] = a.hp;
+        m_agent_team[i] = static_cast<int32_t>(i / agents_multiplicity);
+    }
+
+    const auto &missiles = physx.get_missiles();
+    m_missiles.resize(missiles.size());
+    m_missile_v.resize(missiles.size());
+    m_missile_owner.resize(missiles.size());
+    for (auto i = 0U; i < missiles.size(); i++) {
+        const auto &m = missiles[i];
+        m_missiles.rx[i] = m.r.x;
+        m_missiles.ry[i] = m.r.y;
+        m_missiles.rz[i] = m.r.z;
+        m_missiles.ux[i] = m.u.x;
+        m_missiles.uy[i] = m.u.y;
+        m_missiles.uz[i] = m.u.z;
+        m_missiles.hx[i] = (m.u.y * m.r.z) - (m.u.z * m.r.y);
+        m_missiles.hy[i] = (m.u.z * m.r.x) - (m.u.x * m.r.z);
+        m_missiles.hz[i] = (m.u.x * m.r.y) - (m.u.y * m.r.x);
+        m_missile_v[i] = m.v;
+        m_missile_owner[i] = m.payload;
+    }
+
+    m_agent_radius = physx.get_world().agent_radius;
+    m_scores.resize(std::max(agents.size(), missiles.size()));
+}
+
+int32_t Snapshot::nearest_enemy(const size_t agent_idx) const
+{
+    const auto n = m_agents.rx.size();
+    if (agent_idx >= n) {
+        return -1;
+    }
+
+    const auto x = m_agents.rx[agent_idx];
+    const auto y = m_agents.ry[agent_idx];
+    const auto z = m_agents.rz[agent_idx];
+    const auto team = m_agent_team[agent_idx];
+
+    const auto *rx = m_agents.rx.data();
+    const auto *ry = m_agents.ry.data();
+    const auto *rz = m_agents.rz.data();
+    const auto *hp = m_agent_hp.data();
+    const auto *teams = m_agent_team.data();
+    auto *scores = m_scores.data();
+    for (size_t i = 0; i < n; i++) {
+        const auto proximity = (x * rx[i]) + (y * ry[i]) + (z * rz[i]);
+        const auto candidate =
+            static_cast<float>((teams[i] != team) & (hp[i] > 0.F));
+        scores[i] = proximity + ((1.F - candidate) * -rejected);
+    }
+
+    // Proximities lie in [-1, 1] up to rounding, rejected agents score below
+    // -7.
+    const auto *best = std::max_element(scores, scores + n);
+    return *best > -2.F ? static_cast<int32_t>(best - scores) : -1;
+}
+
+int32_t Snapshot::raycast(const size_t agent_idx) const
+{
+    const auto n = m_agents.rx.size();
+    if (agent_idx >= n) {
+        return -1;
+    }
+
+    const auto x = m_agents.rx[agent_idx];
+    const auto y = m_agents.ry[agent_idx];
+    const auto z = m_agents.rz[agent_idx];
+    const auto ux = m_agents.ux[agent_idx];
+    const auto uy = m_agents.uy[agent_idx];
+    const auto uz = m_agents.uz[agent_idx];
+    const auto hx = m_agents.hx[agent_idx];
+    const auto hy = m_agents.hy[agent_idx];
+    const auto hz = m_agents.hz[agent_idx];
+    const auto radius = m_agent_radius;
+
+    const auto *rx = m_agents.rx.data();
+    const auto *ry = m_agents.ry.data();
+    const auto *rz = m_agents.rz.data();
+    const auto *hp = m_agent_hp.data();
+    auto *scores = m_scores.data();
+    for (size_t i = 0; i < n; i++) {
+        const auto offset = (ux * rx[i]) + (uy * ry[i]) + (uz * rz[i]);
+        const auto c = (x * rx[i]) + (y * ry[i]) + (z * rz[i]);
+        const auto s = (hx * rx[i]) + (hy * ry[i]) + (hz * rz[i]);
+        const auto candidate =
+            static_cast<float>((std::abs(offset) < radius) & (hp[i] > 0.F));
+        scores[i] = pseudo_angle(c, s) + ((1.F - candidate) * rejected);
+    }
+    scores[agent_idx] = rejected;
+
+    const auto *best = std::min_element(scores, scores + n);
+    return *best < rejected ? static_cast<int32_t>(best - scores) : -1;
+}
+
+float Snapshot::time_to_impact(const size_t agent_idx) const
+{
+    if (agent_idx >= m_agents.rx.size()) {
+        return -1.F;
+    }
+
+    const auto x = m_agents.rx[agent_idx];
+    const auto y = m_agents.ry[agent_idx];
+    const auto z = m_agents.rz[agent_idx];
+    const auto self = static_cast<int32_t>(agent_idx);
+    const auto radius = m_agent_radius;
+
+    const auto n = m_missiles.rx.size();
+    const auto *rx = m_missiles.rx.data();
+    const auto *ry = m_missiles.ry.data();
+    const auto *rz = m_missiles.rz.data();
+    const auto *ux = m_missiles.ux.data();
+    const auto *uy = m_missiles.uy.data();
+    const auto *uz = m_missiles.uz.data();
+    const auto *hx = m_missiles.hx.data();
+    const auto *hy = m_missiles.hy.data();
+    const auto *hz = m_missiles.hz.data();
+    const auto *v = m_missile_v.data();
+    const auto *owner = m_missile_owner.data();
+    auto *scores = m_scores.data();
+    for (size_t i = 0; i < n; i++) {
+        const auto offset = (ux[i] * x) + (uy[i] * y) + (uz[i] * z);
+        const auto candidate = static_cast<float>(
+            (std::abs(offset) < radius) & (owner[i] != self) & (v[i] > 0.F));
+        scores[i] = (1.F - candidate) * rejected;
+    }
+
+    // Only missiles on a collision course need the exact angle.
+    auto best = std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < n; i++) {
+        if (scores[i] < rejected) {
+            const auto c = (rx[i] * x) + (ry[i] * y) + (rz[i] * z);
+            const auto s = (hx[i] * x) + (hy[i] * y) + (hz[i] * z);
+            best = std::min(best, angle(c, s) / v[i]);
+        }
+    }
+
+    return std::isinf(best) ? -1.F : best;
+}
+}  // namespace twsfw
@@ -0,0 +1,92 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "twsfw/world_buffer.hpp"
+
+namespace twsfw
+{
+std::vector<uint8_t> &WorldBuffer::next()
+{
+    m_next.clear();
+    return m_next;
+}
+
+void WorldBuffer::publish(const size_t begin,
+                          const std::vector<size_t> &chunk_ends)
+{
+    m_version++;
+
+    if (begin != m_begin or chunk_ends != m_chunk_ends
+        or m_next.size() != m_buffer.size())
+    {
+        m_layout_version = m_version;
+        m_begin = begin;
+        m_chunk_ends = chunk_ends;
+        m_chunk_versions.assign(m_chunk_ends.size(), m_version);
+    } else {
+        auto from = m_begin;
+        for (auto i = 0U; i < m_chunk_ends.size(); i++) {
+            const auto to = m_chunk_ends[i];
+            const auto *next = m_next.data() + from;
+            if (std::memcmp(next, m_buffer.data() + from, to - from) != 0) {
+                m_chunk_versions[i] = m_version;
+            }
+            from = to;
+        }
+    }
+
+    m_buffer.swap(m_next);
+}
+
+size_t WorldBuffer::copy_since(const size_t synced_version,
+                               uint8_t *dst) const
+{
+    if (synced_version < m_layout_version) {
+        std::memcpy(dst + m_begin,
+                    m_buffer.data() + m_begin,
+                    m_buffer.size() - m_begin);
+        return m_buffer.size() - m_begin;
+    }
+
+    // Adjacent changed chunks are copied in one go.
+    size_t n_bytes = 0;
+    auto copy = [&](const size_t from, const size_t to)
+    {
+        std::memcpy(dst + from, m_buffer.data() + from, to - from);
+        n_bytes += to - from;
+    };
+
+    auto from = m_begin;
+    auto dirty_from = from;
+    bool dirty = false;
+    for (auto i = 0U; i < m_chunk_ends.size(); i++) {
+        if (m_chunk_versions[i] > synced_version) {
+            if (not dirty) {
+                dirty_from = from;
+                dirty = true;
+            }
+        } else if (dirty) {
+            copy(dirty_from, from);
+            dirty = false;
+        }
+        from = m_chunk_ends[i];
+    }
+    if (dirty) {
+        copy(dirty_from, from);
+    }
+
+    return n_bytes;
+}
+
+size_t WorldBuffer::version() const
+{
+    return m_version;
+}
+
+const std::vector<uint8_t> &WorldBuffer::data() const
+{
+    return m_buffer;
+}
+}  // namespace twsfw
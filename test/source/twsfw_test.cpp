@@ -1,4 +1,541 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <numbers>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "twsfw/game.hpp"
+#include "twsfw/physx.hpp"
+#include "twsfw/queries.hpp"
+#include "twsfw/world_buffer.hpp"
+
+namespace
+{
+int n_failures = 0;
+
+void check(const bool ok, const char *what)
+{
+    if (not ok) {
+        std::cerr << "FAILED: " << what << '\n';
+        n_failures++;
+    }
+}
+
+bool approx(const float a, const float b)
+{
+    return std::abs(a - b) <= 1e-4F * std::max(1.F, std::abs(b));
+}
+
+// Agent on the equator at longitude `angle`, heading east.
+twsfwphysx_agent equator_agent(const float angle)
+{
+    return {.r = {std::cos(angle), std::sin(angle), 0.F},
+            .u = {0.F, 0.F, 1.F},
+            .v = 0.F,
+            .a = 0.F,
+            .hp = 4.F};
+}
+
+void test_queries()
+{
+    // Teams of two: agents 0 and 1 against agents 2 and 3.
+    twsfw::Physx physx(4,
+                       {.restitution = 1.F,
+                        .agent_radius = .1F,
+                        .missile_acceleration = 0.F});
+    const auto agents = physx.get_agents();
+    agents[0] = equator_agent(0.F);
+    agents[1] = {.r = {0.F, 0.F, 1.F},
+                 .u = {1.F, 0.F, 0.F},
+                 .v = 0.F,
+                 .a = 0.F,
+                 .hp = 4.F};
+    agents[2] = equator_agent(1.F);
+    agents[3] = equator_agent(.5F);
+
+    // Missiles are placed by hand after firing, which only sizes the batch.
+    physx.fire(0, 1.F);
+    physx.fire(2, 1.F);
+    physx.fire(2, 1.F);
+    const auto missiles = physx.get_missiles();
+    // Heads east along the equator, hits agent 0 after .5 rad.
+    missiles[0] = {.r = {std::cos(-.5F), std::sin(-.5F), 0.F},
+                   .u = {0.F, 0.F, 1.F},
+                   .v = .25F,
+                   .payload = 2};
+    // Agent 0's own missile, right behind it.
+    missiles[1] = {.r = {std::cos(-.1F), std::sin(-.1F), 0.F},
+                   .u = {0.F, 0.F, 1.F},
+                   .v = 1.F,
+                   .payload = 0};
+    // Heads north from the equator towards agent 1.
+    missiles[2] = {.r = {0.F, 1.F, 0.F},
+                   .u = {1.F, 0.F, 0.F},
+                   .v = .5F,
+                   .payload = 2};
+
+    twsfw::Snapshot snapshot;
+    snapshot.capture(physx, 2);
+
+    check(snapshot.nearest_enemy(0) == 3, "nearest enemy skips teammates");
+    check(snapshot.nearest_enemy(3) == 0, "nearest enemy of other team");
+    check(snapshot.nearest_enemy(4) == -1, "nearest enemy of unknown agent");
+
+    check(snapshot.raycast(0) == 3, "raycast hits first agent ahead");
+    check(snapshot.raycast(2) == 0, "raycast wraps around the sphere");
+
+    check(approx(snapshot.time_to_impact(0), 2.F),
+          "time to impact skips own missiles");
+    check(approx(snapshot.time_to_impact(2), 1.1F),
+          "time to impact counts missiles of other teams");
+    check(approx(snapshot.time_to_impact(1), std::numbers::pi_v<float>),
+          "time to impact ignores missiles off course");
+    check(approx(snapshot.time_to_impact(3), .6F),
+          "time to impact picks the first missile");
+
+    // The snapshot is unaffected until it is taken again.
+    agents[3].hp = 0.F;
+    check(snapshot.nearest_enemy(0) == 3, "queries read the snapshot");
+
+    snapshot.capture(physx, 2);
+    check(snapshot.nearest_enemy(0) == 2, "nearest enemy skips the dead");
+    check(snapshot.raycast(0) == 2, "raycast skips the dead");
+
+    // Antipodal agents slightly off the unit sphere, as after integration.
+    twsfw::Physx antipodes(2,
+                           {.restitution = 1.F,
+                            .agent_radius = .1F,
+                            .missile_acceleration = 0.F});
+    antipodes.get_agents()[0] = equator_agent(0.F);
+    antipodes.get_agents()[1] = equator_agent(std::numbers::pi_v<float>);
+    antipodes.get_agents()[0].r.x = 1.0001F;
+    antipodes.get_agents()[1].r.x = -1.0001F;
+    snapshot.capture(antipodes, 1);
+    check(snapshot.nearest_enemy(0) == 1, "nearest enemy on the antipode");
+}
+
+using Bytes = std::basic_string<uint8_t>;
+
+void append_leb128(Bytes &out, size_t n)
+{
+    do {
+        const auto byte = static_cast<uint8_t>(n & 0x7fU);
+        n >>= 7U;
+        out.push_back(n == 0 ? byte : byte | 0x80U);
+    } while (n != 0);
+}
+
+void append_sleb128(Bytes &out, int32_t n)
+{
+    while (true) {
+        const auto byte = static_cast<uint8_t>(n & 0x7f);
+        n >>= 7;
+        const auto done = (n == 0 and (byte & 0x40U) == 0)
+            or (n == -1 and (byte & 0x40U) != 0);
+        out.push_back(done ? byte : byte | 0x80U);
+        if (done) {
+            return;
+        }
+    }
+}
+
+Bytes section(const uint8_t id, const Bytes &content)
+{
+    Bytes out{id};
+    append_leb128(out, content.size());
+    return out + content;
+}
+
+Bytes name(const std::string &text)
+{
+    Bytes out;
+    append_leb128(out, text.size());
+    return out + Bytes(text.begin(), text.end());
+}
+
+// Instructions that return `value` from a function.
+Bytes return_f32(const float value)
+{
+    Bytes out{0x43};  // f32.const
+    const auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+    return out + Bytes(bytes, bytes + sizeof(value));
+}
+
+// Minimal agent with one page of memory whose twsfw_agent_act runs `act`.
+// If `alloc_at` is non-zero, it also exports a twsfw_agent_alloc that
+// returns that address whatever the size asked for. With `import_nearest`,
+// twsfw_host_nearest is function 0 and `act` can call it.
+Bytes agent_module(const Bytes &act,
+                   const int32_t alloc_at = 0,
+                   const bool import_nearest = false)
+{
+    const Bytes magic{0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00};
+
+    // 0: (i32 x 8) -> f32, 1: (i32) -> i32
+    Bytes types{0x02, 0x60, 0x08};
+    types += Bytes(8, 0x7f);
+    types += {0x01, 0x7d, 0x60, 0x01, 0x7f, 0x01, 0x7f};
+
+    Bytes imports{0x01};
+    imports += name("env") + name("twsfw_host_nearest") + Bytes{0x00, 0x01};
+    const uint8_t n_imported = import_nearest ? 1 : 0;
+
+    const Bytes memories{0x01, 0x00, 0x01};
+
+    const Bytes act_body = Bytes{0x00} + act + Bytes{0x0b};
+    Bytes functions{0x01, 0x00};
+    Bytes exports{0x02};
+    exports += name("memory") + Bytes{0x02, 0x00};
+    exports += name("twsfw_agent_act") + Bytes{0x00, n_imported};
+    Bytes code{0x01};
+    append_leb128(code, act_body.size());
+    code += act_body;
+
+    if (alloc_at != 0) {
+        Bytes alloc_body{0x00, 0x41};  // i32.const
+        append_sleb128(alloc_body, alloc_at);
+        alloc_body.push_back(0x0b);
+        functions = {0x02, 0x00, 0x01};
+        exports[0] = 0x03;
+        exports += name("twsfw_agent_alloc")
+            + Bytes{0x00, static_cast<uint8_t>(n_imported + 1)};
+        code[0] = 0x02;
+        append_leb128(code, alloc_body.size());
+        code += alloc_body;
+    }
+
+    return magic + section(1, types)
+        + (import_nearest ? section(2, imports) : Bytes{})
+        + section(3, functions) + section(5, memories) + section(7, exports)
+        + section(10, code);
+}
+
+// Never acts, so the action slot keeps the host's ROTATE by 0.
+const Bytes idle_agent = agent_module(return_f32(0.F));
+
+// Rotates by `angle` on every decision.
+Bytes rotating_agent(const float angle)
+{
+    return agent_module(return_f32(angle));
+}
+
+// Stores FIRE through the action pointer.
+const Bytes fire{0x20, 0x07, 0x41, 0x02, 0x36, 0x02, 0x00};
+
+// Fires on every decision.
+const Bytes firing_agent = agent_module(fire + return_f32(0.F));
+
+// Rotates by 0.1 rad times one more than the team it reads for itself from
+// its input, agents[id].team.
+Bytes team_reading_agent(const int32_t alloc_at)
+{
+    Bytes act{0x20, 0x00, 0x20, 0x06, 0x41};  // agents, id, i32.const
+    append_sleb128(act, sizeof(twsfw_agent));
+    act += {0x6c, 0x6a, 0x28, 0x02};  // i32.mul, i32.add, i32.load
+    append_leb128(act, offsetof(twsfw_agent, team));
+    act += Bytes{0xb2} + return_f32(1.F) + Bytes{0x92};  // convert, add
+    act += return_f32(.1F) + Bytes{0x94};  // mul
+    return agent_module(act, alloc_at);
+}
+
+// Rotates by 0.1 rad times one more than its nearest enemy, as the host
+// query answers it.
+const Bytes querying_agent = agent_module(
+    Bytes{0x20, 0x06, 0x10, 0x00, 0xb2}  // id, call 0, convert
+        + return_f32(1.F) + Bytes{0x92} + return_f32(.1F) + Bytes{0x94},
+    0,
+    true);
+
+constexpr twsfw::Game::World test_world{.agent_radius = .1F,
+                                        .agent_healing_rate = 0.F,
+                                        .agent_cooldown = 1.F,
+                                        .agent_max_velocity = 1.F,
+                                        .agent_max_rotation_speed = 10.F,
+                                        .restitution = 1.F,
+                                        .missile_max_velocity = 1.F};
+
+constexpr size_t ticks_per_second = 10;
+constexpr auto tick_time = 1.F / static_cast<float>(ticks_per_second);
+
+twsfw::Game make_game(const std::vector<Bytes> &agents,
+                      const twsfw::Game::World &world = test_world)
+{
+    return twsfw::Game{agents, 1, world, ticks_per_second};
+}
+
+// Bytes copied into a team's memory when its whole input is rewritten.
+size_t full_input_size(const size_t n_agents, const size_t n_missiles)
+{
+    return sizeof(int32_t) + (n_agents * sizeof(twsfw_agent))
+        + (n_missiles * sizeof(twsfw_missile)) + sizeof(twsfw_world);
+}
+
+// Angle by which an agent's heading has turned from the initial one.
+float turned(const twsfw_agent &agent)
+{
+    return std::acos(std::clamp(agent.u.z, -1.F, 1.F));
+}
+
+void test_decision_intervals()
+{
+    const auto full = full_input_size(2, 0);
+
+    {
+        auto game = make_game({idle_agent, idle_agent});
+        for (auto i = 0; i < 3; i++) {
+            game.tick(tick_time, 1);
+            check(game.bytes_copied() == 2 * full,
+                  "by default every team decides on every tick");
+        }
+    }
+
+    {
+        // Team 1 is staggered by one tick and decides on ticks 2 and 5.
+        auto game = make_game({idle_agent, idle_agent});
+        game.set_decision_interval(1, 3);
+        const std::vector<size_t> teams_due{1, 1, 2, 1, 1, 2};
+        for (const auto n_teams : teams_due) {
+            game.tick(tick_time, 1);
+            check(game.bytes_copied() == n_teams * full,
+                  "teams decide on staggered ticks");
+        }
+    }
+
+    {
+        auto game = make_game({rotating_agent(.2F)});
+        game.set_decision_interval(4);
+        twsfw::Game::State state;
+        for (auto i = 0; i < 4; i++) {
+            state = game.tick(tick_time, 1);
+        }
+        check(approx(turned(state.agents[0]), .8F),
+              "hold repeats the last rotation");
+    }
+
+    {
+        auto game = make_game({rotating_agent(.2F)});
+        game.set_decision_interval(4);
+        game.set_action_policy(twsfw::Game::ActionPolicy::decay, .5F);
+        twsfw::Game::State state;
+        for (auto i = 0; i < 4; i++) {
+            state = game.tick(tick_time, 1);
+        }
+        check(approx(turned(state.agents[0]), .2F + .1F + .05F + .025F),
+              "decay scales the last rotation down");
+    }
+
+    {
+        auto game = make_game({firing_agent});
+        twsfw::Game::State state;
+        for (auto i = 0; i < 4; i++) {
+            state = game.tick(tick_time, 1);
+        }
+        check(state.missiles.size() == 4, "every decision fires");
+
+        game = make_game({firing_agent});
+        game.set_decision_interval(4);
+        for (auto i = 0; i < 4; i++) {
+            state = game.tick(tick_time, 1);
+        }
+        check(state.missiles.size() == 1, "hold does not fire again");
+    }
+}
+
+void test_incremental_input()
+{
+    constexpr int32_t input_at = 4096;
+
+    {
+        // After the first call only the action slots are rewritten.
+        auto game = make_game({agent_module(return_f32(0.F), input_at),
+                               agent_module(return_f32(0.F), input_at)});
+        game.tick(tick_time, 1);
+        check(game.bytes_copied() == 2 * full_input_size(2, 0),
+              "first input is copied in full");
+        for (auto i = 0; i < 3; i++) {
+            game.tick(tick_time, 1);
+            check(game.bytes_copied() == 2 * sizeof(int32_t),
+                  "unchanged input is not copied again");
+        }
+    }
+
+    {
+        // A new missile changes the layout, which is copied in full.
+        auto game = make_game({agent_module(fire + return_f32(0.F), input_at),
+                               agent_module(return_f32(0.F), input_at)});
+        const auto state = game.tick(tick_time, 1);
+        check(state.missiles.size() == 1, "input region agent fires");
+        game.tick(tick_time, 1);
+        check(game.bytes_copied() == 2 * full_input_size(2, 1),
+              "change of missile count rewrites the input");
+    }
+
+    {
+        // Agents read their input where they asked for it, also when it is
+        // only partially rewritten.
+        auto game =
+            make_game({team_reading_agent(input_at), team_reading_agent(0)});
+        twsfw::Game::State state;
+        for (auto i = 0; i < 3; i++) {
+            state = game.tick(tick_time, 1);
+        }
+        check(approx(turned(state.agents[0]), .3F),
+              "agent reads the input region");
+        check(approx(turned(state.agents[1]), .6F),
+              "agent reads the start of its memory");
+    }
+}
+
+void test_advance()
+{
+    {
+        auto game = make_game({idle_agent, idle_agent});
+        const auto summary =
+            game.advance(20, tick_time, 1, twsfw::Game::one_team_left);
+        check(summary.ticks == 20, "advance runs all ticks");
+        check(summary.teams_alive == 2, "advance counts teams alive");
+        check(summary.agents_alive == 2, "advance counts agents alive");
+    }
+
+    {
+        auto game = make_game({idle_agent});
+        const auto summary =
+            game.advance(20, tick_time, 1, twsfw::Game::one_team_left);
+        check(summary.ticks == 1, "advance stops when one team is left");
+    }
+
+    {
+        // Agents lose 2 hp per tick and start with 4.
+        auto world = test_world;
+        world.agent_healing_rate = -20.F;
+        auto game = make_game({idle_agent, idle_agent}, world);
+        const auto summary =
+            game.advance(20, tick_time, 1, twsfw::Game::all_dead);
+        check(summary.ticks == 2, "advance stops when all are dead");
+        check(summary.agents_alive == 0, "advance counts the dead");
+        check(summary.team_hp == std::vector{0.F, 0.F},
+              "advance sums hp of living agents");
+    }
+}
+
+void test_limits()
+{
+    {
+        auto game = make_game({idle_agent, idle_agent});
+        game.tick(tick_time, 1);
+        check(game.agent_peak_memory() == std::vector<size_t>{65536, 65536},
+              "peak memory of one page");
+    }
+
+    // The defaults, except for half a page of memory.
+    constexpr size_t kib = size_t{1} << 10U;
+    constexpr twsfw::Game::Limits limits{.memory_size = 32 * kib,
+                                         .table_elements = 10'000,
+                                         .memory_reservation = 64 * kib * kib,
+                                         .memory_reservation_for_growth =
+                                             16 * kib * kib,
+                                         .memory_guard_size = 64 * kib};
+    bool thrown = false;
+    try {
+        const twsfw::Game game{
+            {idle_agent}, 1, test_world, ticks_per_second, limits};
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    check(thrown, "memory below one page does not instantiate");
+}
+
+void test_construction()
+{
+    {
+        // The game moves out of the future, host queries have to follow it.
+        auto game = twsfw::Game::create({querying_agent, querying_agent},
+                                        1,
+                                        test_world,
+                                        ticks_per_second)
+                        .get();
+        check(game.compile_times().size() == 2, "one compile time per team");
+
+        twsfw::Game::State state;
+        for (auto i = 0; i < 2; i++) {
+            state = game.tick(tick_time, 1);
+        }
+        check(approx(turned(state.agents[0]), .4F),
+              "created game answers host queries");
+        check(approx(turned(state.agents[1]), .2F),
+              "created game answers host queries for every team");
+    }
+
+    std::string message;
+    try {
+        const auto game = make_game({idle_agent, Bytes{0x00, 0x61}});
+    } catch (const std::runtime_error &error) {
+        message = error.what();
+    }
+    check(message.starts_with("Could not build WASM module 1: "),
+          "invalid module is reported with its index");
+}
+
+void publish(twsfw::WorldBuffer &buffer,
+             const std::vector<uint8_t> &bytes,
+             const std::vector<size_t> &chunk_ends)
+{
+    buffer.next() = bytes;
+    buffer.publish(4, chunk_ends);
+}
+
+void test_world_buffer()
+{
+    // A 4 byte header the buffer leaves alone, then one chunk per agent and
+    // one for all missiles.
+    std::vector<uint8_t> bytes(16, 0);
+    std::vector<size_t> chunk_ends{8, 12, 16};
+    std::vector<uint8_t> dst(32, 0xff);
+
+    twsfw::WorldBuffer buffer;
+    publish(buffer, bytes, chunk_ends);
+    check(buffer.copy_since(0, dst.data()) == 12, "first copy is full");
+    check(dst[3] == 0xff and dst[4] == 0, "header is not copied");
+    const auto synced = buffer.version();
+
+    bytes[9] = 1;
+    publish(buffer, bytes, chunk_ends);
+    check(buffer.copy_since(synced, dst.data()) == 4,
+          "only the changed agent is copied");
+    check(dst[9] == 1, "changed bytes are copied");
+    check(buffer.copy_since(buffer.version(), dst.data()) == 0,
+          "nothing is copied when synced");
+
+    bytes[4] = 1;
+    bytes[12] = 1;
+    publish(buffer, bytes, chunk_ends);
+    check(buffer.copy_since(buffer.version() - 1, dst.data()) == 8,
+          "all changed chunks are copied");
+    check(buffer.copy_since(synced, dst.data()) == 12,
+          "changes of all missed versions are copied");
+
+    // One more missile.
+    bytes.resize(20, 0);
+    chunk_ends.back() = 20;
+    publish(buffer, bytes, chunk_ends);
+    check(buffer.copy_since(buffer.version() - 1, dst.data()) == 16,
+          "a change of layout is copied in full");
+}
+}  // namespace
+
 int main(int, char **)
 {
-    return 0;
+    test_queries();
+    test_decision_intervals();
+    test_incremental_input();
+    test_advance();
+    test_limits();
+    test_construction();
+    test_world_buffer();
+
+    return n_failures == 0 ? 0 : 1;
 }